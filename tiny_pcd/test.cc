@@ -0,0 +1,504 @@
+#include <gtest/gtest.h>
+
+#include "tiny_pcd.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+// every fixture is written by relative name, run the whole suite inside a scratch directory and drop it afterwards
+class ScratchDirectory : public ::testing::Environment {
+ public:
+  void SetUp() override {
+    char pattern[] = "/tmp/tiny_pcd_test.XXXXXX";
+    ASSERT_NE(mkdtemp(pattern), nullptr);
+    path_ = pattern;
+    char *cwd = getcwd(nullptr, 0);
+    ASSERT_NE(cwd, nullptr);
+    cwd_ = cwd;
+    std::free(cwd);
+    ASSERT_EQ(chdir(path_.c_str()), 0);
+  }
+
+  void TearDown() override {
+    ASSERT_EQ(chdir(cwd_.c_str()), 0);
+    if (auto *dir = opendir(path_.c_str())) {
+      for (auto *entry = readdir(dir); entry; entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+          std::remove((path_ + "/" + name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    ASSERT_EQ(rmdir(path_.c_str()), 0);
+  }
+
+ private:
+  std::string path_;
+  std::string cwd_;
+};
+
+const auto *const scratch_directory = ::testing::AddGlobalTestEnvironment(new ScratchDirectory);
+
+struct XyzI {
+  float x, y, z;
+  uint32_t intensity;
+};
+
+std::vector<XyzI> make_points(size_t n) {
+  std::vector<XyzI> points(n);
+  for (size_t i = 0; i < n; ++i) {
+    points[i] = {0.5f * i, -0.25f * i, 1.0f + i, static_cast<uint32_t>(i * 3)};
+  }
+  return points;
+}
+
+std::string pcd_header(size_t n, const std::string &data, const std::string &view_point = "0 0 0 1 0 0 0") {
+  return "# .PCD v0.7 - Point Cloud Data file format\n"
+         "VERSION 0.7\n"
+         "FIELDS x y z intensity\n"
+         "SIZE 4 4 4 4\n"
+         "TYPE F F F U\n"
+         "COUNT 1 1 1 1\n"
+         "WIDTH " +
+         std::to_string(n) +
+         "\n"
+         "HEIGHT 1\n"
+         "VIEWPOINT " +
+         view_point +
+         "\n"
+         "POINTS " +
+         std::to_string(n) + "\nDATA " + data + "\n";
+}
+
+std::string write_ascii(const std::string &filename, const std::vector<XyzI> &points,
+                        const std::string &view_point = "0 0 0 1 0 0 0") {
+  std::ofstream file(filename, std::ios::trunc);
+  file << pcd_header(points.size(), "ascii", view_point);
+  for (const auto &p : points) {
+    file << p.x << " " << p.y << " " << p.z << " " << p.intensity << "\n";
+  }
+  return filename;
+}
+
+std::string write_binary(const std::string &filename, const std::vector<XyzI> &points,
+                         const std::string &view_point = "0 0 0 1 0 0 0") {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file << pcd_header(points.size(), "binary", view_point);
+  file.write(reinterpret_cast<const char *>(points.data()), points.size() * sizeof(XyzI));
+  return filename;
+}
+}  // namespace
+
+TEST(TinyPcd, CacheColumns) {
+  using namespace tiny_pcd;
+  const auto points = make_points(100);
+  for (const auto &filename : {write_ascii("cache_ascii.pcd", points), write_binary("cache_binary.pcd", points)}) {
+    std::remove(TinyPcdCache::default_path(filename).c_str());
+    TinyPcdCache cache(filename);
+    ASSERT_EQ(cache.size(), points.size());
+    const auto x = cache.column<float>("x");
+    const auto intensity = cache.column<uint32_t>("intensity");
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(x.data()) % 64, 0);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(intensity.data()) % 64, 0);
+    for (size_t i = 0; i < points.size(); ++i) {
+      ASSERT_FLOAT_EQ(x[i], points[i].x);
+      ASSERT_EQ(intensity[i], points[i].intensity);
+    }
+    ASSERT_THROW(cache.column<double>("x"), std::runtime_error);
+  }
+}
+
+TEST(TinyPcd, CacheRebuild) {
+  using namespace tiny_pcd;
+  const auto filename = write_binary("cache_rebuild.pcd", make_points(10));
+  std::remove(TinyPcdCache::default_path(filename).c_str());
+  ASSERT_EQ(TinyPcdCache(filename).size(), 10);
+
+  auto points = make_points(20);
+  points[0].x = 42.0f;
+  write_binary(filename, points);
+  TinyPcdCache cache(filename);
+  ASSERT_EQ(cache.size(), 20);
+  ASSERT_FLOAT_EQ(cache.column<float>("x")[0], 42.0f);
+  ASSERT_DOUBLE_EQ(cache.header().view_point.qw, 1);
+}
+
+TEST(TinyPcd, CacheTouchedSource) {
+  using namespace tiny_pcd;
+  const auto points = make_points(10);
+  const auto filename = write_binary("cache_touched.pcd", points);
+  const auto cache_filename = TinyPcdCache::default_path(filename);
+  std::remove(cache_filename.c_str());
+  TinyPcdCache{filename};
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  write_binary(filename, points);  // same content, new mtime
+  ASSERT_EQ(TinyPcdCache(filename).size(), 10);
+
+  // source_mtime of the cache header follows the source
+  struct stat sb;
+  ASSERT_EQ(stat(filename.c_str(), &sb), 0);
+  int64_t cached_mtime = 0;
+  std::ifstream cache(cache_filename, std::ios::binary);
+  cache.seekg(40);
+  cache.read(reinterpret_cast<char *>(&cached_mtime), sizeof(cached_mtime));
+  ASSERT_EQ(cached_mtime, static_cast<int64_t>(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec);
+}
+
+TEST(TinyPcd, CacheFailedBuildLeavesNoTemp) {
+  using namespace tiny_pcd;
+  {
+    std::ofstream file("cache_bad.pcd", std::ios::trunc);
+    file << pcd_header(2, "ascii") << "1 2 3 4\n1 2\n";
+  }
+  for (auto i = 0; i < 2; ++i) {
+    ASSERT_THROW(TinyPcdCache("cache_bad.pcd"), std::runtime_error);
+  }
+  const auto temp = TinyPcdCache::default_path("cache_bad.pcd") + ".tmp.";
+  auto *dir = opendir(".");
+  size_t temps = 0;
+  for (auto *entry = readdir(dir); entry; entry = readdir(dir)) {
+    temps += std::string(entry->d_name).rfind(temp, 0) == 0;
+  }
+  closedir(dir);
+  ASSERT_EQ(temps, 0);
+}
+
+TEST(TinyPcd, CacheConcurrentBuild) {
+  using namespace tiny_pcd;
+  const auto filename = write_binary("cache_concurrent.pcd", make_points(10000));
+  const auto cache_filename = TinyPcdCache::default_path(filename);
+  std::atomic<size_t> errors{0};
+  std::vector<std::thread> builders;
+  for (auto t = 0; t < 4; ++t) {
+    builders.emplace_back([&]() {
+      try {
+        for (auto i = 0; i < 5; ++i) {
+          TinyPcdCache::build(filename, cache_filename);
+        }
+      } catch (const std::exception &) {
+        ++errors;
+      }
+    });
+  }
+  for (auto &builder : builders) {
+    builder.join();
+  }
+  ASSERT_EQ(errors, 0);
+  ASSERT_EQ(TinyPcdCache(filename).size(), 10000);
+}
+
+TEST(TinyPcd, ReducePrecision) {
+  using namespace tiny_pcd;
+  const auto points = make_points(1000);
+  const TinyPcd pcd(write_binary("reduce.pcd", points));
+  const auto x = pcd.column<double>("x");
+  ASSERT_EQ(x.size(), points.size());
+
+  const auto fixed16 = pcd.reduce("x", Precision::FIXED16);
+  ASSERT_EQ(fixed16.bytes(), points.size() * sizeof(int16_t));
+  ASSERT_LE(fixed16.max_error(), fixed16.scale() / 2 + 1e-9);
+
+  const auto centimeter = pcd.reduce("z", Precision::FIXED32, 0.01);
+  ASSERT_DOUBLE_EQ(centimeter.scale(), 0.01);
+  ASSERT_LE(centimeter.max_error(), 0.005 + 1e-9);
+  ASSERT_THROW(pcd.reduce("z", Precision::FIXED16, 1e-4), std::runtime_error);
+
+  const auto half = pcd.reduce("y", Precision::FLOAT16);
+  const auto decoded = half.decode<float>();
+  for (size_t i = 0; i < points.size(); ++i) {
+    ASSERT_NEAR(decoded[i], points[i].y, std::abs(points[i].y) / 1024);
+    ASSERT_DOUBLE_EQ(half[i], decoded[i]);
+  }
+  ASSERT_EQ(pcd.reduce("x", Precision::FLOAT32).max_error(), 0);
+}
+
+TEST(TinyPcd, ReduceNonFinite) {
+  using namespace tiny_pcd;
+  const std::vector<double> values = {1.0, NAN, INFINITY, -2.0};
+  ASSERT_THROW(ReducedColumn(values, Precision::FIXED16), std::runtime_error);
+  ASSERT_THROW(ReducedColumn(values, Precision::FIXED32, 0.01), std::runtime_error);
+
+  const ReducedColumn f32(values, Precision::FLOAT32);
+  ASSERT_EQ(f32.max_error(), 0);
+  ASSERT_TRUE(std::isnan(f32[1]));
+  ASSERT_EQ(f32[2], INFINITY);
+
+  // 1e6 overflows half precision, the loss shows up as an infinite error
+  const ReducedColumn f16({1.0, 1e6}, Precision::FLOAT16);
+  ASSERT_TRUE(std::isinf(f16.max_error()));
+}
+
+TEST(TinyPcd, ConcurrentRandomAccess) {
+  using namespace tiny_pcd;
+  const auto points = make_points(5000);
+  for (const auto &filename : {write_ascii("shared_ascii.pcd", points), write_binary("shared_binary.pcd", points)}) {
+    const TinyPcd pcd(filename);
+    std::atomic<size_t> errors{0};
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < 8; ++t) {
+      workers.emplace_back([&, t]() {
+        std::mt19937 rng(t);
+        for (auto i = 0; i < 20000; ++i) {
+          const auto index = rng() % points.size();
+          const auto point = pcd[index];
+          if (point.get<float>("x") != points[index].x || point.get<uint32_t>("intensity") != points[index].intensity) {
+            ++errors;
+          }
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    ASSERT_EQ(errors, 0);
+  }
+}
+
+TEST(TinyPcd, TruncatedAsciiIndex) {
+  using namespace tiny_pcd;
+  {
+    std::ofstream file("truncated.pcd", std::ios::trunc);
+    file << pcd_header(3, "ascii") << "1 2 3 4\n5 6 7 8\n";
+  }
+  const TinyPcd pcd("truncated.pcd");
+  ASSERT_THROW(pcd[0], std::runtime_error);
+  ASSERT_THROW(pcd[1], std::runtime_error);  // every access reports it, none blocks
+}
+
+TEST(TinyPcd, AsciiLinesAgree) {
+  using namespace tiny_pcd;
+  {
+    std::ofstream file("blank_lines.pcd", std::ios::binary | std::ios::trunc);
+    file << pcd_header(3, "ascii") << "\r\n1 2 3 4\r\n  \t \n5\t6  7 8\r\n\n9 10 11 12\r\n \n";
+  }
+  const TinyPcd pcd("blank_lines.pcd");
+  const std::vector<float> expected{1, 5, 9};
+  std::vector<float> iterated;
+  for (const auto &point : pcd) {
+    iterated.push_back(point.get<float>("x"));
+  }
+  ASSERT_EQ(iterated, expected);
+  ASSERT_FLOAT_EQ(pcd[1].get<float>("y"), 6);
+  ASSERT_EQ(pcd[2].get<uint32_t>("intensity"), 12);
+  ASSERT_EQ(pcd.column<float>("x"), expected);
+  const TinyPcdCache cache("blank_lines.pcd");
+  const auto intensity = cache.column<uint32_t>("intensity");
+  ASSERT_EQ(std::vector<uint32_t>(intensity.begin(), intensity.end()), std::vector<uint32_t>({4, 8, 12}));
+}
+
+TEST(TinyPcd, IteratorCopy) {
+  using namespace tiny_pcd;
+  const TinyPcd pcd(write_binary("shared_header.pcd", make_points(10)));
+  auto it = pcd.begin();
+  auto copy = it;
+  ++copy;
+  ASSERT_FLOAT_EQ((*it).get<float>("x"), 0.0f);
+  ASSERT_FLOAT_EQ((*copy).get<float>("x"), 0.5f);
+}
+
+// benchmark, run with --gtest_also_run_disabled_tests --gtest_filter='*Throughput'
+TEST(TinyPcd, DISABLED_ConcurrentRandomAccessThroughput) {
+  using namespace tiny_pcd;
+  const auto points = make_points(100000);
+  for (const auto &filename : {write_ascii("bench_ascii.pcd", points), write_binary("bench_binary.pcd", points)}) {
+    const TinyPcd pcd(filename);
+    pcd[points.size() - 1];  // build the ascii index outside the measurement
+    for (uint32_t threads = 1; threads <= std::max(8u, std::thread::hardware_concurrency()); threads *= 2) {
+      constexpr auto kAccess = 200000;
+      std::atomic<double> sink{0};
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> workers;
+      for (uint32_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+          std::mt19937 rng(t);
+          double sum = 0;
+          for (auto i = 0; i < kAccess; ++i) {
+            sum += pcd[rng() % points.size()].get<float>("x");
+          }
+          sink = sum;
+        });
+      }
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      printf("%s threads %u: %.2f M points/s\n", filename.c_str(), threads, threads * kAccess / elapsed.count() / 1e6);
+    }
+  }
+}
+
+TEST(TinyPcd, ViewPointTransform) {
+  using namespace tiny_pcd;
+  const auto points = make_points(37);
+  const std::string view_point = "1 2 3 0.70710678 0 0 0.70710678";  // 90 degrees around z
+  for (const auto &filename : {write_ascii("viewpoint_ascii.pcd", points, view_point),
+                                write_binary("viewpoint_binary.pcd", points, view_point)}) {
+    const TinyPcd pcd(filename);
+    ASSERT_DOUBLE_EQ(pcd.header().view_point.tz, 3);
+    ASSERT_DOUBLE_EQ(pcd.header().view_point.qz, 0.70710678);
+
+    const auto world = pcd.xyz<float>();
+    const auto world64 = pcd.xyz<double>();
+    ASSERT_EQ(world.x.size(), points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+      ASSERT_NEAR(world.x[i], 1 - points[i].y, 1e-4);
+      ASSERT_NEAR(world.y[i], 2 + points[i].x, 1e-4);
+      ASSERT_NEAR(world.z[i], 3 + points[i].z, 1e-4);
+      ASSERT_NEAR(world64.x[i], world.x[i], 1e-4);
+    }
+  }
+}
+
+TEST(TinyPcd, TransformIndependentOfPosition) {
+  using namespace tiny_pcd;
+  // utm-sized translation, float rounding of the constants would show up
+  const Transform transform({0.6, -0.8, 0, 500123.37, 0.8, 0.6, 0, 4000001.91, 0, 0, 1, 12.3, 0, 0, 0, 1});
+  Xyz<float> xyz{std::vector<float>(13, 50.3f), std::vector<float>(13, 21.1f), std::vector<float>(13, 1.5f)};
+  Xyz<double> xyz64{std::vector<double>(13, 50.3f), std::vector<double>(13, 21.1f), std::vector<double>(13, 1.5f)};
+  transform.apply(xyz);
+  transform.apply(xyz64);
+  for (size_t i = 0; i < xyz.x.size(); ++i) {
+    ASSERT_EQ(xyz.x[i], xyz.x[0]);
+    ASSERT_EQ(xyz.y[i], xyz.y[0]);
+    ASSERT_EQ(xyz.z[i], xyz.z[0]);
+    ASSERT_EQ(xyz.y[i], static_cast<float>(xyz64.y[i]));
+  }
+}
+
+TEST(TinyPcd, MatrixTransform) {
+  using namespace tiny_pcd;
+  const Transform transform({0, 0, 1, 10, 1, 0, 0, 20, 0, 1, 0, 30, 0, 0, 0, 1});
+  Xyz<float> xyz;
+  for (auto i = 0; i < 19; ++i) {
+    xyz.x.push_back(i);
+    xyz.y.push_back(2 * i);
+    xyz.z.push_back(3 * i);
+  }
+  transform.apply(xyz);
+  for (auto i = 0; i < 19; ++i) {
+    ASSERT_FLOAT_EQ(xyz.x[i], 3 * i + 10);
+    ASSERT_FLOAT_EQ(xyz.y[i], i + 20);
+    ASSERT_FLOAT_EQ(xyz.z[i], 2 * i + 30);
+  }
+  ASSERT_THROW(Transform({1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 2}), std::runtime_error);
+  ASSERT_THROW(Transform({1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 1}), std::runtime_error);
+}
+
+TEST(TinyPcd, Merge) {
+  using namespace tiny_pcd;
+  const auto points = make_points(50);
+  {
+    std::ofstream file("merge_xyz.pcd", std::ios::trunc);
+    file << "VERSION 0.7\nFIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nWIDTH 2\nHEIGHT 1\nPOINTS 2\nDATA ascii\n"
+            "7 8 9\n10 11 12\n";
+  }
+  const std::vector<std::string> inputs = {write_binary("merge_binary.pcd", points), "merge_xyz.pcd",
+                                           write_ascii("merge_ascii.pcd", points)};
+  TinyPcd::merge(inputs, "merge_output.pcd", 2);
+
+  const TinyPcd merged("merge_output.pcd");
+  ASSERT_EQ(merged.size(), 2 * points.size() + 2);
+  ASSERT_EQ(merged.fields(), (std::vector<std::string>{"x", "y", "z", "intensity"}));
+  for (size_t i = 0; i < points.size(); ++i) {
+    ASSERT_FLOAT_EQ(merged[i].get<float>("y"), points[i].y);
+    ASSERT_EQ(merged[i].get<uint32_t>("intensity"), points[i].intensity);
+    ASSERT_FLOAT_EQ(merged[i + points.size() + 2].get<float>("x"), points[i].x);
+    ASSERT_EQ(merged[i + points.size() + 2].get<uint32_t>("intensity"), points[i].intensity);
+  }
+  ASSERT_FLOAT_EQ(merged[points.size() + 1].get<float>("z"), 12);
+  ASSERT_EQ(merged[points.size() + 1].get<uint32_t>("intensity"), 0);
+
+  // merging into one of the inputs replaces it only once everything is read
+  TinyPcd::merge({"merge_ascii.pcd", "merge_xyz.pcd"}, "merge_ascii.pcd");
+  const TinyPcd in_place("merge_ascii.pcd");
+  ASSERT_EQ(in_place.size(), points.size() + 2);
+  ASSERT_FLOAT_EQ(in_place[points.size() - 1].get<float>("z"), points.back().z);
+  ASSERT_FLOAT_EQ(in_place[points.size()].get<float>("x"), 7);
+
+  write_binary("merge_moved.pcd", points, "1 0 0 1 0 0 0");
+  ASSERT_THROW(TinyPcd::merge({inputs[0], "merge_moved.pcd"}, "merge_output.pcd"), std::runtime_error);
+}
+
+TEST(TinyPcd, ValidPoints) {
+  using namespace tiny_pcd;
+  auto points = make_points(45);
+  for (const auto i : {3, 8, 9, 20, 44}) {
+    points[i].x = NAN;
+  }
+  points[31].z = INFINITY;
+  points[32].y = -INFINITY;
+  for (const auto &filename : {write_ascii("valid_ascii.pcd", points), write_binary("valid_binary.pcd", points)}) {
+    const TinyPcd pcd(filename);
+    ASSERT_FALSE(pcd.is_dense());
+    const auto valid = pcd.valid_indices();
+    ASSERT_EQ(valid.size(), points.size() - 7);
+    ASSERT_EQ(pcd.valid_size(), valid.size());
+    ASSERT_EQ(pcd.valid().size(), valid.size());
+    ASSERT_FALSE(pcd.is_valid(44));
+    ASSERT_TRUE(pcd.is_valid(43));
+    ASSERT_THROW(pcd.is_valid(points.size()), std::runtime_error);
+    ASSERT_EQ(valid[3], 4);
+
+    std::vector<uint32_t> intensity;
+    for (const auto &point : pcd.valid()) {
+      ASSERT_TRUE(std::isfinite(point.get<float>("x")));
+      intensity.push_back(point.get<uint32_t>("intensity"));
+    }
+    ASSERT_EQ(intensity, pcd.column<uint32_t>("intensity", true));
+    ASSERT_EQ(intensity[3], points[4].intensity);
+  }
+
+  const TinyPcd dense(write_binary("valid_dense.pcd", make_points(10)));
+  ASSERT_TRUE(dense.is_dense());
+  ASSERT_EQ(dense.column<float>("x", true).size(), 10);
+  ASSERT_EQ(dense.valid_indices().size(), 10);
+  ASSERT_TRUE(dense.is_valid(9));
+  ASSERT_THROW(dense.is_valid(10), std::runtime_error);
+
+  // invalid points across mask words, and a whole word of them
+  auto many = make_points(200);
+  for (auto i = 60; i < 140; ++i) {
+    many[i].z = NAN;
+  }
+  many[199].x = NAN;
+  const TinyPcd sparse(write_binary("valid_sparse.pcd", many));
+  std::vector<float> expected;
+  for (auto i = 0; i < 199; ++i) {
+    if (i < 60 || i >= 140) {
+      expected.push_back(many[i].x);
+    }
+  }
+  ASSERT_EQ(sparse.column<float>("x", true), expected);
+  size_t visited = 0;
+  for (const auto &point : sparse.valid()) {
+    ASSERT_FLOAT_EQ(point.get<float>("x"), expected[visited++]);
+  }
+  ASSERT_EQ(visited, expected.size());
+}
+
+TEST(TinyPcd, ValidPointsNeedScalarCoordinates) {
+  using namespace tiny_pcd;
+  {
+    std::ofstream file("valid_count.pcd", std::ios::trunc);
+    file << "VERSION 0.7\nFIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 2 1 1\nWIDTH 2\nHEIGHT 1\nPOINTS 2\n"
+            "DATA ascii\n1 2 3 4\n5 6 7 8\n";
+  }
+  const TinyPcd pcd("valid_count.pcd");
+  ASSERT_EQ(pcd.column<float>("x").size(), 4);
+  ASSERT_THROW(pcd.is_dense(), std::runtime_error);
+  ASSERT_THROW(pcd.valid().begin(), std::runtime_error);
+}
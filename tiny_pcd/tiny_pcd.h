@@ -2,13 +2,26 @@
 #define TINY_PCD_H
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <fstream>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -20,8 +33,14 @@
 #include <unistd.h>
 #endif
 
+#if defined(__AVX__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
 namespace tiny_pcd {
 
+class TinyPcdCache;
+
 namespace {
 std::string to_string(const std::string_view &str) { return std::string(str); }
 
@@ -74,6 +93,39 @@ static std::string to_iso_type(const std::string &type, uint32_t size) {
       return value;
     }
   }
+  throw std::runtime_error("Unknown type " + type + " of size " + std::to_string(size));
+}
+
+// write one numeric token of an ascii pcd as the native binary value of type
+template <typename T> static void store_number(const std::string_view &str, char *out) {
+  const auto value = to_number<T>(str);
+  std::memcpy(out, &value, sizeof(T));
+}
+
+static void store_number(const std::string_view &str, const std::string &type, char *out) {
+  if (type == "int8") {
+    store_number<int8_t>(str, out);
+  } else if (type == "uint8") {
+    store_number<uint8_t>(str, out);
+  } else if (type == "int16") {
+    store_number<int16_t>(str, out);
+  } else if (type == "uint16") {
+    store_number<uint16_t>(str, out);
+  } else if (type == "int32") {
+    store_number<int32_t>(str, out);
+  } else if (type == "uint32") {
+    store_number<uint32_t>(str, out);
+  } else if (type == "int64") {
+    store_number<int64_t>(str, out);
+  } else if (type == "uint64") {
+    store_number<uint64_t>(str, out);
+  } else if (type == "float32") {
+    store_number<float>(str, out);
+  } else if (type == "float64") {
+    store_number<double>(str, out);
+  } else {
+    throw std::runtime_error("Unknown type " + type);
+  }
 }
 
 bool starts_with(const std::string_view &str, const std::string_view &prefix) {
@@ -88,8 +140,442 @@ void trim(std::string_view &str) {
     str.remove_suffix(1);
   }
 }
+
+// the one rule for which ascii lines are points: take the next line, trimmed of spaces, tabs and a trailing \r,
+// and skip the blank ones. returns an empty view once blocks is exhausted
+std::string_view next_line(std::string_view &blocks) {
+  while (!blocks.empty()) {
+    auto line = blocks.substr(0, blocks.find('\n'));
+    blocks.remove_prefix(std::min(blocks.size(), line.size() + 1));
+    trim(line);
+    if (!line.empty()) {
+      return line;
+    }
+  }
+  return {};
+}
+
+// next token of a trimmed ascii line, separated by any run of spaces or tabs
+std::string_view next_token(std::string_view &line) {
+  const auto pos = std::min(line.find_first_of(" \t"), line.size());
+  const auto token = line.substr(0, pos);
+  line.remove_prefix(pos);
+  trim(line);
+  return token;
+}
 }  // namespace
 
+// create an empty temp file next to filename and return its path. the name is claimed by an exclusive create,
+// so concurrent writers in any process, thread or translation unit never share one
+inline std::string create_temp(const std::string &filename) {
+  static std::atomic<uint64_t> counter{0};
+#ifdef __linux__
+  const auto owner = std::to_string(getpid());
+#else
+  const auto owner = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+  const auto thread = std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  for (auto attempt = 0; attempt < 100; ++attempt) {
+    const auto path = filename + ".tmp." + owner + "." + thread + "." + std::to_string(counter++);
+    if (auto *file = std::fopen(path.c_str(), "wbx")) {
+      std::fclose(file);
+      return path;
+    }
+  }
+  throw std::runtime_error("Failed to create a temp file for " + filename);
+}
+
+// reduced-precision storage of one decoded field, fixed-point values are stored as (value - offset) / scale
+enum class Precision { FLOAT32, FLOAT16, FIXED16, FIXED32 };
+
+class ReducedColumn {
+ public:
+  // resolution only applies to fixed-point, 0 picks the finest scale that covers the data bounds.
+  // fixed-point throws on nan or inf, the float precisions keep them
+  ReducedColumn(const std::vector<double> &values, Precision precision, double resolution = 0)
+      : precision_(precision), size_(values.size()) {
+    switch (precision_) {
+      case Precision::FLOAT32:
+        f32_.resize(size_);
+        to_float_(values.data(), f32_.data(), size_);
+        break;
+      case Precision::FLOAT16:
+        f16_.resize(size_);
+        to_half_(values.data(), f16_.data(), size_);
+        break;
+      case Precision::FIXED16:
+        choose_scale_(values, resolution, std::numeric_limits<int16_t>::max());
+        i16_.resize(size_);
+        to_fixed_(values.data(), i16_.data(), size_, offset_, scale_);
+        break;
+      case Precision::FIXED32:
+        choose_scale_(values, resolution, std::numeric_limits<int32_t>::max());
+        i32_.resize(size_);
+        to_fixed_(values.data(), i32_.data(), size_, offset_, scale_);
+        break;
+    }
+    measure_error_(values.data());
+  }
+
+  Precision precision() const { return precision_; }
+  size_t size() const { return size_; }
+  double offset() const { return offset_; }
+  double scale() const { return scale_; }
+  // largest absolute difference to the source values
+  double max_error() const { return max_error_; }
+
+  size_t bytes() const {
+    return f32_.size() * sizeof(float) + f16_.size() * sizeof(uint16_t) + i16_.size() * sizeof(int16_t) +
+           i32_.size() * sizeof(int32_t);
+  }
+
+  double operator[](size_t index) const {
+    switch (precision_) {
+      case Precision::FLOAT32:
+        return f32_[index];
+      case Precision::FLOAT16:
+        return half_to_float_(f16_[index]);
+      case Precision::FIXED16:
+        return i16_[index] * scale_ + offset_;
+      case Precision::FIXED32:
+        return i32_[index] * scale_ + offset_;
+    }
+    return 0;
+  }
+
+  // expand [first, first + n) back into out
+  template <typename T> void decode(T *out, size_t first = 0, size_t n = std::numeric_limits<size_t>::max()) const {
+    n = std::min(n, size_ - std::min(first, size_));
+    switch (precision_) {
+      case Precision::FLOAT32:
+        std::copy(f32_.data() + first, f32_.data() + first + n, out);
+        break;
+      case Precision::FLOAT16:
+        from_half_(f16_.data() + first, out, n);
+        break;
+      case Precision::FIXED16:
+        from_fixed_(i16_.data() + first, out, n, offset_, scale_);
+        break;
+      case Precision::FIXED32:
+        from_fixed_(i32_.data() + first, out, n, offset_, scale_);
+        break;
+    }
+  }
+
+  template <typename T = double> std::vector<T> decode() const {
+    std::vector<T> result(size_);
+    decode(result.data());
+    return result;
+  }
+
+ private:
+  // the kernels below are plain loops over contiguous arrays, written for the compiler to vectorize
+  static void to_float_(const double *__restrict in, float *__restrict out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = static_cast<float>(in[i]);
+    }
+  }
+
+  template <typename Q>
+  static void to_fixed_(const double *__restrict in, Q *__restrict out, size_t n, double offset, double scale) {
+    const auto inv_scale = 1.0 / scale;
+    for (size_t i = 0; i < n; ++i) {
+      const auto q = (in[i] - offset) * inv_scale;
+      out[i] = static_cast<Q>(q + (q >= 0 ? 0.5 : -0.5));
+    }
+  }
+
+  template <typename Q, typename T>
+  static void from_fixed_(const Q *__restrict in, T *__restrict out, size_t n, double offset, double scale) {
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = static_cast<T>(in[i] * scale + offset);
+    }
+  }
+
+  static void to_half_(const double *__restrict in, uint16_t *__restrict out, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+    for (; i + 8 <= n; i += 8) {
+      const auto lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i));
+      const auto hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + i + 4));
+      const auto half = _mm256_cvtps_ph(_mm256_set_m128(hi, lo), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), half);
+    }
+#endif
+    for (; i < n; ++i) {
+      out[i] = float_to_half_(static_cast<float>(in[i]));
+    }
+  }
+
+  template <typename T> static void from_half_(const uint16_t *__restrict in, T *__restrict out, size_t n) {
+    size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+    alignas(32) float buffer[8];
+    for (; i + 8 <= n; i += 8) {
+      _mm256_store_ps(buffer, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i))));
+      for (size_t j = 0; j < 8; ++j) {
+        out[i + j] = static_cast<T>(buffer[j]);
+      }
+    }
+#endif
+    for (; i < n; ++i) {
+      out[i] = static_cast<T>(half_to_float_(in[i]));
+    }
+  }
+
+  // IEEE 754 binary16 with round to nearest even
+  static uint16_t float_to_half_(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const uint32_t abs = bits & 0x7fffffff;
+    if (abs >= 0x7f800000) {  // inf or nan
+      return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    if (abs >= 0x477ff000) {  // overflow after rounding
+      return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) {  // subnormal or zero
+      if (abs < 0x33000000) {
+        return sign;
+      }
+      const uint32_t shift = 126 - (abs >> 23);
+      const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+      uint32_t half = mantissa >> shift;
+      const uint32_t rest = mantissa & ((1u << shift) - 1);
+      const uint32_t halfway = 1u << (shift - 1);
+      half += (rest > halfway || (rest == halfway && (half & 1))) ? 1 : 0;
+      return sign | half;
+    }
+    uint32_t half = ((abs >> 13) - (112 << 10));
+    const uint32_t rest = abs & 0x1fff;
+    half += (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ? 1 : 0;
+    return sign | half;
+  }
+
+  static float half_to_float_(uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+      bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+      bits = sign;
+    } else {
+      uint32_t e = 113;
+      while ((mantissa & 0x400) == 0) {
+        mantissa <<= 1;
+        --e;
+      }
+      bits = sign | (e << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  void choose_scale_(const std::vector<double> &values, double resolution, double limit) {
+    if (values.empty()) {
+      return;
+    }
+    // nan and inf have no fixed-point code, drop them before reducing
+    if (!std::all_of(values.begin(), values.end(), [](double value) { return std::isfinite(value); })) {
+      throw std::runtime_error("Fixed-point needs finite values, got nan or inf.");
+    }
+    const auto [min_it, max_it] = std::minmax_element(values.begin(), values.end());
+    offset_ = (*min_it + *max_it) / 2;
+    const auto half_range = (*max_it - *min_it) / 2;
+    if (resolution > 0) {
+      if (half_range / resolution > limit) {
+        throw std::runtime_error("Resolution " + std::to_string(resolution) + " can't cover range " +
+                                 std::to_string(half_range * 2));
+      }
+      scale_ = resolution;
+    } else if (half_range > 0) {
+      scale_ = half_range / limit;
+    }
+  }
+
+  void measure_error_(const double *values) {
+    constexpr size_t kChunk = 1024;
+    double buffer[kChunk];
+    for (size_t first = 0; first < size_; first += kChunk) {
+      const auto n = std::min(kChunk, size_ - first);
+      decode(buffer, first, n);
+      for (size_t i = 0; i < n; ++i) {
+        const auto source = values[first + i];
+        if (buffer[i] == source || (std::isnan(buffer[i]) && std::isnan(source))) {
+          continue;  // also covers inf kept as inf
+        }
+        // nan once any value is lost, std::max would drop it
+        const auto error = std::abs(buffer[i] - source);
+        max_error_ = (std::isnan(error) || error > max_error_) ? error : max_error_;
+      }
+    }
+  }
+
+ private:
+  Precision precision_;
+  size_t size_;
+  double offset_{0};
+  double scale_{1};
+  double max_error_{0};
+  std::vector<float> f32_;
+  std::vector<uint16_t> f16_;
+  std::vector<int16_t> i16_;
+  std::vector<int32_t> i32_;
+};
+
+// sensor acquisition pose of a pcd, translation then quaternion as written in VIEWPOINT
+struct ViewPoint {
+  double tx{0}, ty{0}, tz{0};
+  double qw{1}, qx{0}, qy{0}, qz{0};
+};
+
+// x, y, z columns of a cloud
+template <typename T> struct Xyz {
+  std::vector<T> x, y, z;
+};
+
+#ifdef __AVX__
+namespace {
+template <typename T> struct AvxLane;
+
+template <> struct AvxLane<float> {
+  using V = __m256;
+  static constexpr size_t kWidth = 8;
+  static V load(const float *p) { return _mm256_loadu_ps(p); }
+  // 4 lanes to and from double
+  static __m256d widen(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+  static void narrow(float *p, __m256d v) { _mm_storeu_ps(p, _mm256_cvtpd_ps(v)); }
+  // bit i set when lane i of x, y and z is finite, v - v is nan for both nan and inf
+  static int finite(V x, V y, V z) {
+    const auto zero = _mm256_setzero_ps();
+    const auto fx = _mm256_cmp_ps(_mm256_sub_ps(x, x), zero, _CMP_EQ_OQ);
+    const auto fy = _mm256_cmp_ps(_mm256_sub_ps(y, y), zero, _CMP_EQ_OQ);
+    const auto fz = _mm256_cmp_ps(_mm256_sub_ps(z, z), zero, _CMP_EQ_OQ);
+    return _mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(fx, fy), fz));
+  }
+};
+
+template <> struct AvxLane<double> {
+  using V = __m256d;
+  static constexpr size_t kWidth = 4;
+  static V load(const double *p) { return _mm256_loadu_pd(p); }
+  static __m256d widen(const double *p) { return _mm256_loadu_pd(p); }
+  static void narrow(double *p, __m256d v) { _mm256_storeu_pd(p, v); }
+  static int finite(V x, V y, V z) {
+    const auto zero = _mm256_setzero_pd();
+    const auto fx = _mm256_cmp_pd(_mm256_sub_pd(x, x), zero, _CMP_EQ_OQ);
+    const auto fy = _mm256_cmp_pd(_mm256_sub_pd(y, y), zero, _CMP_EQ_OQ);
+    const auto fz = _mm256_cmp_pd(_mm256_sub_pd(z, z), zero, _CMP_EQ_OQ);
+    return _mm256_movemask_pd(_mm256_and_pd(_mm256_and_pd(fx, fy), fz));
+  }
+};
+}  // namespace
+#endif
+
+// rigid transform p' = R * p + t
+class Transform {
+ public:
+  Transform() = default;
+
+  explicit Transform(const ViewPoint &vp) : t_{vp.tx, vp.ty, vp.tz} {
+    const auto norm = std::sqrt(vp.qw * vp.qw + vp.qx * vp.qx + vp.qy * vp.qy + vp.qz * vp.qz);
+    if (norm == 0) {
+      throw std::runtime_error("Invalid VIEWPOINT quaternion.");
+    }
+    const auto w = vp.qw / norm, x = vp.qx / norm, y = vp.qy / norm, z = vp.qz / norm;
+    r_ = {1 - 2 * (y * y + z * z), 2 * (x * y - z * w),     2 * (x * z + y * w),
+          2 * (x * y + z * w),     1 - 2 * (x * x + z * z), 2 * (y * z - x * w),
+          2 * (x * z - y * w),     2 * (y * z + x * w),     1 - 2 * (x * x + y * y)};
+  }
+
+  // row-major 4x4 rigid or affine matrix, a projective last row other than 0 0 0 1 is rejected
+  explicit Transform(const std::array<double, 16> &matrix)
+      : r_{matrix[0], matrix[1], matrix[2], matrix[4], matrix[5], matrix[6], matrix[8], matrix[9], matrix[10]},
+        t_{matrix[3], matrix[7], matrix[11]} {
+    if (matrix[12] != 0 || matrix[13] != 0 || matrix[14] != 0 || matrix[15] != 1) {
+      throw std::runtime_error("Invalid transform, the last row must be 0 0 0 1.");
+    }
+  }
+
+  const std::array<double, 9> &rotation() const { return r_; }
+  const std::array<double, 3> &translation() const { return t_; }
+
+  template <typename T> void apply(Xyz<T> &xyz) const {
+    if (xyz.x.size() != xyz.y.size() || xyz.x.size() != xyz.z.size()) {
+      throw std::runtime_error("Columns of x, y, z differ in size.");
+    }
+    apply(xyz.x.data(), xyz.y.data(), xyz.z.data(), xyz.x.size());
+  }
+
+  // in-place transform of n points stored as separate x, y, z columns
+  template <typename T> void apply(T *x, T *y, T *z, size_t n) const {
+    static_assert(std::is_floating_point_v<T>, "only float and double columns can be transformed");
+#ifdef __AVX__
+    apply_avx_(x, y, z, n);
+#else
+    const auto &r = r_;
+    for (size_t i = 0; i < n; ++i) {
+      const double px = x[i], py = y[i], pz = z[i];
+      x[i] = static_cast<T>(r[0] * px + r[1] * py + r[2] * pz + t_[0]);
+      y[i] = static_cast<T>(r[3] * px + r[4] * py + r[5] * pz + t_[1]);
+      z[i] = static_cast<T>(r[6] * px + r[7] * py + r[8] * pz + t_[2]);
+    }
+#endif
+  }
+
+ private:
+#ifdef __AVX__
+  // always computes in double, float lanes are widened. the tail goes through the same kernel on a padded
+  // block so a point's result never depends on its position
+  template <typename T> void apply_avx_(T *x, T *y, T *z, size_t n) const {
+    using S = AvxLane<T>;
+    constexpr size_t kWidth = 4;
+    __m256d r[9], t[3];
+    for (size_t k = 0; k < 9; ++k) {
+      r[k] = _mm256_set1_pd(r_[k]);
+    }
+    for (size_t k = 0; k < 3; ++k) {
+      t[k] = _mm256_set1_pd(t_[k]);
+    }
+    const auto row = [&](size_t k, __m256d px, __m256d py, __m256d pz) {
+      const auto xy = _mm256_add_pd(_mm256_mul_pd(r[3 * k], px), _mm256_mul_pd(r[3 * k + 1], py));
+      return _mm256_add_pd(_mm256_add_pd(xy, _mm256_mul_pd(r[3 * k + 2], pz)), t[k]);
+    };
+    const auto block = [&](T *bx, T *by, T *bz) {
+      const auto px = S::widen(bx), py = S::widen(by), pz = S::widen(bz);
+      S::narrow(bx, row(0, px, py, pz));
+      S::narrow(by, row(1, px, py, pz));
+      S::narrow(bz, row(2, px, py, pz));
+    };
+
+    size_t i = 0;
+    for (; i + kWidth <= n; i += kWidth) {
+      block(x + i, y + i, z + i);
+    }
+    if (i < n) {
+      T bx[kWidth] = {}, by[kWidth] = {}, bz[kWidth] = {};
+      std::copy(x + i, x + n, bx);
+      std::copy(y + i, y + n, by);
+      std::copy(z + i, z + n, bz);
+      block(bx, by, bz);
+      std::copy(bx, bx + n - i, x + i);
+      std::copy(by, by + n - i, y + i);
+      std::copy(bz, bz + n - i, z + i);
+    }
+  }
+#endif
+
+ private:
+  std::array<double, 9> r_{1, 0, 0, 0, 1, 0, 0, 0, 1};
+  std::array<double, 3> t_{0, 0, 0};
+};
+
 // ref to: https://pointclouds.org/documentation/tutorials/pcd_file_format.html
 class TinyPcd {
  private:
@@ -106,25 +592,24 @@ class TinyPcd {
     std::vector<uint32_t> count;
     uint32_t width;
     uint32_t height;
-    std::string view_point;  // what's it?
+    ViewPoint view_point;
     uint64_t points;
     PcdType pcd_type;
   };
 
   class Point {
    public:
-    Point(const Header &header, const strview &block) : header_(header), point_(header.field.size()) {
+    Point(const std::shared_ptr<const Header> &header, const strview &block)
+        : header_(header), point_(header->field.size()) {
       auto block_start = block;
-      for (auto i = 0; i < header.field.size(); ++i) {
-        if (header.pcd_type == PcdType::ASCII) {
+      for (auto i = 0; i < header->field.size(); ++i) {
+        if (header->pcd_type == PcdType::ASCII) {
           if (block_start.empty()) {
-            throw std::runtime_error("Parse error, field not found.\n" + std::string(block) + "\n" + header.field[i]);
+            throw std::runtime_error("Parse error, field not found.\n" + std::string(block) + "\n" + header->field[i]);
           }
-          const auto pos = block_start.find(' ');
-          point_[i] = block_start.substr(0, pos);
-          block_start.remove_prefix(pos + 1);
-        } else if (header.pcd_type == PcdType::BINARY) {
-          const auto item_size = header.size[i] * header.count[i];
+          point_[i] = next_token(block_start);
+        } else if (header->pcd_type == PcdType::BINARY) {
+          const auto item_size = header->size[i] * header->count[i];
           point_[i] = block_start.substr(0, item_size);
           block_start.remove_prefix(item_size);
         }
@@ -140,8 +625,8 @@ class TinyPcd {
 
     template <typename T> T get(const std::string &field) const {
       const auto field_idx = field_idx_(field);
-      if (header_.pcd_type == PcdType::BINARY) {
-        return to_number<T>(point_[field_idx], header_.iso_type[field_idx]);
+      if (header_->pcd_type == PcdType::BINARY) {
+        return to_number<T>(point_[field_idx], header_->iso_type[field_idx]);
       } else {
         return std::stod(std::string(point_.at(field_idx)));
       }
@@ -149,47 +634,44 @@ class TinyPcd {
 
    private:
     int64_t field_idx_(const std::string &field) const {
-      const auto field_it = std::find(header_.field.begin(), header_.field.end(), field);
-      if (field_it == header_.field.end()) {
+      const auto field_it = std::find(header_->field.begin(), header_->field.end(), field);
+      if (field_it == header_->field.end()) {
         throw std::runtime_error("Unknow filed " + field);
       }
-      return field_it - header_.field.begin();
+      return field_it - header_->field.begin();
     }
 
    private:
-    const Header &header_;
+    std::shared_ptr<const Header> header_;
     std::vector<strview> point_;
   };
 
   class Iterator {
    public:
-    Iterator(const Header &header, const strview &blocks) : blocks_(blocks), header_(header) {
-      if (header_.pcd_type == PcdType::ASCII) {
-        forward_iter_ = [this]() {
-          const auto next_line = blocks_.find('\n');
-          if (next_line == strview::npos) {
-            blocks_ = strview();
-          } else {
-            blocks_ = blocks_.substr(next_line + 1);
-          }
-        };
-      } else if (header_.pcd_type == PcdType::BINARY) {
-        forward_iter_ = [this]() { blocks_ = blocks_.substr(block_size_(header_)); };
-      } else {
+    Iterator(const std::shared_ptr<const Header> &header, const strview &blocks) : header_(header), blocks_(blocks) {
+      if (header_->pcd_type != PcdType::ASCII && header_->pcd_type != PcdType::BINARY) {
         throw std::runtime_error("Unknown PCD type.");
       }
+      if (header_->pcd_type == PcdType::ASCII) {
+        line_ = next_line(blocks_);
+      }
     }
+    // stateless stepping, copies of an iterator advance independently
     Iterator &operator++() {
-      forward_iter_();
+      if (header_->pcd_type == PcdType::ASCII) {
+        line_ = next_line(blocks_);
+      } else {
+        blocks_ = blocks_.substr(block_size_(*header_));
+      }
       return *this;
     }
-    bool operator!=(const Iterator &other) const { return blocks_ != other.blocks_; }
-    Point operator*() const { return Point(header_, blocks_); }
+    bool operator!=(const Iterator &other) const { return line_ != other.line_ || blocks_ != other.blocks_; }
+    Point operator*() const { return Point(header_, header_->pcd_type == PcdType::ASCII ? line_ : blocks_); }
 
    private:
-    const Header &header_;
+    std::shared_ptr<const Header> header_;
     strview blocks_;
-    std::function<void(void)> forward_iter_{nullptr};
+    strview line_;  // current ascii point, blocks_ then holds what follows it
   };
 
  private:
@@ -207,17 +689,18 @@ class TinyPcd {
         throw std::runtime_error("Failed to get file size.");
       }
 
-      buffer_ = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, file_, 0);
+      size_ = sb.st_size;
+      buffer_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
       if (buffer_ == MAP_FAILED) {
         throw std::runtime_error("Failed to map the file.");
       }
 
-      view_ = strview(static_cast<const char *>(buffer_), sb.st_size);
+      view_ = strview(static_cast<const char *>(buffer_), size_);
     }
 
     ~Io() {
       if (buffer_ != MAP_FAILED) {
-        munmap(buffer_, 0);
+        munmap(buffer_, size_);
       }
       if (file_ != -1) {
         close(file_);
@@ -226,6 +709,7 @@ class TinyPcd {
 
    private:
     int file_{-1};
+    size_t size_{0};
     void *buffer_{MAP_FAILED};
 
 #else
@@ -258,13 +742,20 @@ class TinyPcd {
   };
 
  public:
+  friend class TinyPcdCache;
+
   TinyPcd(const std::string &filename) : io_(filename) { parse_header_(io_.view()); }
-  Header header() const { return header_; }
-  auto size() const { return header_.points; }
-  auto fields() const { return header_.field; }
-  auto width() const { return header_.width; }
-  auto height() const { return header_.height; }
-  auto version() const { return header_.version; }
+  TinyPcd(const TinyPcd &) = delete;
+  TinyPcd &operator=(const TinyPcd &) = delete;
+
+  Header header() const { return *header_; }
+  // immutable once parsed, the header outlives the TinyPcd but points do not, they view its file
+  std::shared_ptr<const Header> shared_header() const { return header_; }
+  auto size() const { return header_->points; }
+  auto fields() const { return header_->field; }
+  auto width() const { return header_->width; }
+  auto height() const { return header_->height; }
+  auto version() const { return header_->version; }
 
   Iterator begin() const { return Iterator(header_, blocks_); }
   Iterator end() const { return Iterator(header_, strview()); }
@@ -286,28 +777,554 @@ class TinyPcd {
     return result;
   }
 
-  Point operator[](int index) const {
-    if (index >= header_.points) {
+  // decode one field of every point, fields with COUNT > 1 are laid out point by point
+  template <typename T> std::vector<T> column(const std::string &field) const {
+    const auto field_idx = field_idx_(field);
+    const auto n = header_->points * header_->count[field_idx];
+    std::vector<char> raw(n * header_->size[field_idx]);
+    copy_column_(field_idx, raw.data());
+
+    std::vector<T> result(n);
+    const auto &type = header_->iso_type[field_idx];
+    const auto convert = [&](auto tag) {
+      using S = decltype(tag);
+      const auto *src = reinterpret_cast<const S *>(raw.data());
+      std::transform(src, src + n, result.begin(), [](S value) { return static_cast<T>(value); });
+    };
+    if (type == "int8") {
+      convert(int8_t{});
+    } else if (type == "uint8") {
+      convert(uint8_t{});
+    } else if (type == "int16") {
+      convert(int16_t{});
+    } else if (type == "uint16") {
+      convert(uint16_t{});
+    } else if (type == "int32") {
+      convert(int32_t{});
+    } else if (type == "uint32") {
+      convert(uint32_t{});
+    } else if (type == "int64") {
+      convert(int64_t{});
+    } else if (type == "uint64") {
+      convert(uint64_t{});
+    } else if (type == "float32") {
+      convert(float{});
+    } else if (type == "float64") {
+      convert(double{});
+    } else {
+      throw std::runtime_error("Unknown type " + type);
+    }
+    return result;
+  }
+
+  // decode one field, skipping points whose x, y or z is nan or inf when valid_only is set
+  template <typename T> std::vector<T> column(const std::string &field, bool valid_only) const {
+    auto result = column<T>(field);
+    if (!valid_only || is_dense()) {
+      return result;
+    }
+    const auto count = header_->count[field_idx_(field)];
+    size_t kept = 0;
+    for (auto i = next_valid_(0); i < header_->points; i = next_valid_(i + 1), ++kept) {
+      std::copy_n(result.begin() + i * count, count, result.begin() + kept * count);
+    }
+    result.resize(kept * count);
+    return result;
+  }
+
+  // decode one field into reduced-precision storage, e.g. float64 map coordinates into centimeter FIXED32
+  ReducedColumn reduce(const std::string &field, Precision precision, double resolution = 0) const {
+    return ReducedColumn(column<double>(field), precision, resolution);
+  }
+
+  bool is_dense() const { return validity_().dense; }
+  uint64_t valid_size() const { return validity_().size; }
+  bool is_valid(uint64_t index) const {
+    if (index >= header_->points) {
       throw std::runtime_error("Index out of range.");
     }
-    if (header_.pcd_type == PcdType::ASCII) {
-      if (points_.empty()) {
-        points_.emplace_back(begin());
+    const auto &validity = validity_();
+    return validity.dense || (validity.mask[index / 64] >> (index % 64) & 1);
+  }
+
+  // compact list of the finite points, built on demand and not kept
+  std::vector<uint64_t> valid_indices() const {
+    std::vector<uint64_t> result;
+    result.reserve(valid_size());
+    for (auto i = next_valid_(0); i < header_->points; i = next_valid_(i + 1)) {
+      result.push_back(i);
+    }
+    return result;
+  }
+
+  // points with finite x, y and z
+  class Valid {
+   public:
+    class Iterator {
+     public:
+      Iterator(const TinyPcd &pcd, uint64_t index) : pcd_(pcd), index_(index) {}
+      Iterator &operator++() {
+        index_ = pcd_.next_valid_(index_ + 1);
+        return *this;
       }
-      auto it = points_.back();
-      for (int32_t idx = points_.size(); idx <= index; ++idx) {
-        ++it;
-        points_.emplace_back(it);
+      bool operator!=(const Iterator &other) const { return index_ != other.index_; }
+      Point operator*() const { return pcd_.at_(index_); }
+
+     private:
+      const TinyPcd &pcd_;
+      uint64_t index_;
+    };
+
+    Valid(const TinyPcd &pcd) : pcd_(pcd) {}
+    Iterator begin() const { return Iterator(pcd_, pcd_.next_valid_(0)); }
+    Iterator end() const { return Iterator(pcd_, pcd_.size()); }
+    size_t size() const { return pcd_.valid_size(); }
+
+   private:
+    const TinyPcd &pcd_;
+  };
+
+  Valid valid() const { return Valid(*this); }
+
+  // x, y, z of every point moved into the frame given by VIEWPOINT
+  template <typename T> Xyz<T> xyz() const { return xyz<T>(Transform(header_->view_point)); }
+
+  // binary files are decoded and transformed chunk by chunk straight from the mapping
+  template <typename T> Xyz<T> xyz(const Transform &transform) const {
+    const size_t idx[3] = {field_idx_("x"), field_idx_("y"), field_idx_("z")};
+    Xyz<T> result;
+    if (header_->pcd_type != PcdType::BINARY ||
+        std::any_of(std::begin(idx), std::end(idx), [this](size_t i) { return header_->count[i] != 1; })) {
+      result.x = column<T>("x");
+      result.y = column<T>("y");
+      result.z = column<T>("z");
+      transform.apply(result);
+      return result;
+    }
+
+    const auto n = header_->points;
+    const auto stride = block_size_(*header_);
+    std::vector<T> *columns[3] = {&result.x, &result.y, &result.z};
+    Gather<T> gathers[3];
+    const char *sources[3];
+    for (size_t k = 0; k < 3; ++k) {
+      columns[k]->resize(n);
+      gathers[k] = gather_<T>(header_->iso_type[idx[k]]);
+      sources[k] = blocks_.data() + field_offset_(idx[k]);
+    }
+    constexpr size_t kChunk = 1024;
+    for (size_t first = 0; first < n; first += kChunk) {
+      const auto m = std::min<size_t>(kChunk, n - first);
+      for (size_t k = 0; k < 3; ++k) {
+        gathers[k](sources[k] + first * stride, stride, columns[k]->data() + first, m);
       }
-      return *(points_[index]);
-    } else {
-      return Point(header_, blocks_.substr(index * block_size_(header_)));
+      transform.apply(result.x.data() + first, result.y.data() + first, result.z.data() + first, m);
+    }
+    return result;
+  }
+
+  // concatenate pcd files into one binary pcd, fields are the union of all inputs in order of first appearance
+  // and points missing a field are zero. payloads are copied by threads straight into the preallocated output.
+  static void merge(const std::vector<std::string> &filenames, const std::string &output, uint32_t threads = 0) {
+    if (filenames.empty()) {
+      throw std::runtime_error("Nothing to merge.");
+    }
+    std::vector<std::unique_ptr<TinyPcd>> inputs;
+    for (const auto &filename : filenames) {
+      inputs.push_back(std::make_unique<TinyPcd>(filename));
+    }
+
+    Header header;
+    header.version = "0.7";
+    header.width = 0;
+    header.height = 1;
+    header.points = 0;
+    header.pcd_type = PcdType::BINARY;
+    for (size_t k = 0; k < inputs.size(); ++k) {
+      const auto &in = *inputs[k]->header_;
+      if (in.iso_type.size() != in.field.size()) {
+        throw std::runtime_error("Incomplete header in " + filenames[k] + ", FIELDS, SIZE and TYPE are required.");
+      }
+      const auto &vp = in.view_point, &first = inputs.front()->header_->view_point;
+      if (std::tie(vp.tx, vp.ty, vp.tz, vp.qw, vp.qx, vp.qy, vp.qz) !=
+          std::tie(first.tx, first.ty, first.tz, first.qw, first.qx, first.qy, first.qz)) {
+        throw std::runtime_error("Incompatible VIEWPOINT in " + filenames[k]);
+      }
+      header.view_point = vp;
+      for (size_t i = 0; i < in.field.size(); ++i) {
+        const auto it = std::find(header.field.begin(), header.field.end(), in.field[i]);
+        if (it == header.field.end()) {
+          header.field.push_back(in.field[i]);
+          header.size.push_back(in.size[i]);
+          header.type.push_back(in.type[i]);
+          header.iso_type.push_back(in.iso_type[i]);
+          header.count.push_back(in.count[i]);
+          continue;
+        }
+        const auto j = it - header.field.begin();
+        if (header.iso_type[j] != in.iso_type[i] || header.count[j] != in.count[i]) {
+          throw std::runtime_error("Incompatible field " + in.field[i] + " in " + filenames[k]);
+        }
+      }
+      header.points += in.points;
+    }
+    header.width = header.points;
+
+    // every input owns a fixed slice of the output, known before any payload is read
+    const auto stride = block_size_(header);
+    const auto text = header_text_(header);
+    std::vector<uint64_t> offsets{text.size()};
+    for (const auto &input : inputs) {
+      offsets.push_back(offsets.back() + input->header_->points * stride);
+    }
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    const auto copy_one = [&](size_t k, char *out) {
+      try {
+        inputs[k]->encode_(header, out);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error = error ? error : std::current_exception();
+      }
+    };
+
+#ifdef __linux__
+    // write aside and rename, output may be one of the still mapped inputs
+    // create_temp claimed the name with an exclusive create, so the file is ours and empty
+    const auto target = create_temp(output);
+    const auto file = open(target.c_str(), O_RDWR);
+    if (file == -1) {
+      throw std::runtime_error("Failed to create the file " + target);
+    }
+    const auto total = offsets.back();
+    void *mapping = MAP_FAILED;
+    if (ftruncate(file, total) == -1 ||
+        (mapping = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)) == MAP_FAILED) {
+      close(file);
+      std::remove(target.c_str());
+      throw std::runtime_error("Failed to map the file " + target);
+    }
+    auto *base = static_cast<char *>(mapping);
+    std::memcpy(base, text.data(), text.size());
+
+    std::atomic<size_t> next{0};
+    const auto copy_all = [&]() {
+      for (auto k = next++; k < inputs.size(); k = next++) {
+        copy_one(k, base + offsets[k]);
+      }
+    };
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    const auto finish = [&]() {
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      munmap(mapping, total);
+      close(file);
+    };
+    try {
+      for (uint32_t t = 1; t < std::min<size_t>(threads, inputs.size()); ++t) {
+        workers.emplace_back(copy_all);
+      }
+    } catch (...) {
+      // a worker failed to start, drain the queue so the started ones stop early, then unwind
+      next = inputs.size();
+      finish();
+      std::remove(target.c_str());
+      throw;
+    }
+    copy_all();
+    finish();
+#else
+    (void)threads;  // no shared mapping to fill in parallel, inputs are encoded one by one
+    const auto &target = output;  // inputs are already copied into memory, overwriting one is safe
+    std::ofstream file(output, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("Failed to create the file " + output);
+    }
+    file.write(text.data(), text.size());
+    for (size_t k = 0; k < inputs.size() && !error; ++k) {
+      std::vector<char> payload(offsets[k + 1] - offsets[k]);
+      copy_one(k, payload.data());
+      file.write(payload.data(), payload.size());
     }
+    file.close();
+#endif
+    if (error) {
+      std::remove(target.c_str());
+      std::rethrow_exception(error);
+    }
+#ifdef __linux__
+    if (std::rename(target.c_str(), output.c_str()) != 0) {
+      std::remove(target.c_str());
+      throw std::runtime_error("Failed to replace the file " + output);
+    }
+#endif
   }
 
+  Point operator[](int index) const { return at_(index); }
+
  private:
+  Point at_(uint64_t index) const {
+    if (index >= header_->points) {
+      throw std::runtime_error("Index out of range.");
+    }
+    if (header_->pcd_type == PcdType::ASCII) {
+      return Point(header_, lines_()[index]);
+    } else {
+      return Point(header_, blocks_.substr(index * block_size_(*header_)));
+    }
+  }
+
+  // finite x, y and z as one bit per point, scanned once on first use. a dense cloud keeps no mask at all
+  struct Validity {
+    bool dense{true};
+    uint64_t size{0};
+    std::vector<uint64_t> mask;
+    std::exception_ptr error;  // a failed scan is reported on every call
+  };
+
+  const Validity &validity_() const {
+    const size_t idx[3] = {field_idx_("x"), field_idx_("y"), field_idx_("z")};
+    if (std::any_of(std::begin(idx), std::end(idx), [this](size_t i) { return header_->count[i] != 1; })) {
+      throw std::runtime_error("Validity needs x, y and z with COUNT 1.");
+    }
+    // nothing escapes call_once, a callable that throws may leave the flag unusable
+    std::call_once(valid_once_, [this, &idx]() {
+      try {
+        const auto all_float = std::all_of(std::begin(idx), std::end(idx),
+                                           [this](size_t i) { return header_->iso_type[i] == "float32"; });
+        if (all_float) {
+          scan_finite_(column<float>("x"), column<float>("y"), column<float>("z"), validity_state_);
+        } else {
+          scan_finite_(column<double>("x"), column<double>("y"), column<double>("z"), validity_state_);
+        }
+      } catch (...) {
+        validity_state_.error = std::current_exception();
+      }
+    });
+    if (validity_state_.error) {
+      std::rethrow_exception(validity_state_.error);
+    }
+    return validity_state_;
+  }
+
+  // first valid index not before from, size() when there is none
+  uint64_t next_valid_(uint64_t from) const {
+    const auto &validity = validity_();
+    const auto n = header_->points;
+    if (validity.dense || from >= n) {
+      return std::min(from, n);
+    }
+    auto word = from / 64;
+    auto bits = validity.mask[word] >> (from % 64);
+    if (bits == 0) {
+      for (++word; word < validity.mask.size() && validity.mask[word] == 0; ++word) {
+      }
+      if (word == validity.mask.size()) {
+        return n;
+      }
+      from = word * 64;
+      bits = validity.mask[word];
+    }
+    while ((bits & 1) == 0) {
+      bits >>= 1;
+      ++from;
+    }
+    return from;
+  }
+
+  template <typename T>
+  static void scan_finite_(const std::vector<T> &x, const std::vector<T> &y, const std::vector<T> &z,
+                           Validity &validity) {
+    const auto n = x.size();
+    auto &mask = validity.mask;
+    mask.assign((n + 63) / 64, 0);
+    size_t i = 0;
+#ifdef __AVX__
+    using S = AvxLane<T>;
+    for (; i + S::kWidth <= n; i += S::kWidth) {
+      // kWidth divides 64, a block never straddles two words
+      const uint64_t bits = S::finite(S::load(x.data() + i), S::load(y.data() + i), S::load(z.data() + i));
+      mask[i / 64] |= bits << (i % 64);
+    }
+#endif
+    for (; i < n; ++i) {
+      if (x[i] - x[i] == 0 && y[i] - y[i] == 0 && z[i] - z[i] == 0) {
+        mask[i / 64] |= uint64_t{1} << (i % 64);
+      }
+    }
+
+    validity.size = 0;
+    for (const auto word : mask) {
+      validity.size += std::bitset<64>(word).count();
+    }
+    validity.dense = validity.size == n;
+    if (validity.dense) {
+      mask.clear();
+      mask.shrink_to_fit();
+    }
+  }
+
+  // line index of an ascii pcd, built once on first random access and read-only afterwards
+  const std::vector<strview> &lines_() const {
+    std::call_once(lines_once_, [this]() {
+      lines_index_.clear();
+      lines_index_.reserve(header_->points);
+      auto blocks = blocks_;
+      while (lines_index_.size() < header_->points) {
+        const auto line = next_line(blocks);
+        if (line.empty()) {
+          break;
+        }
+        lines_index_.push_back(line);
+      }
+    });
+    // thrown outside call_once, a callable that throws may leave the flag unusable
+    if (lines_index_.size() < header_->points) {
+      throw std::runtime_error("Parse error, expect " + std::to_string(header_->points) + " points but got " +
+                               std::to_string(lines_index_.size()));
+    }
+    return lines_index_;
+  }
+
+  size_t field_idx_(const std::string &field) const {
+    const auto field_it = std::find(header_->field.begin(), header_->field.end(), field);
+    if (field_it == header_->field.end()) {
+      throw std::runtime_error("Unknow filed " + field);
+    }
+    return field_it - header_->field.begin();
+  }
+
+  // pcd header text of a binary file
+  static std::string header_text_(const Header &header) {
+    const auto join = [&header](auto &&f) {
+      std::string line;
+      for (size_t i = 0; i < header.field.size(); ++i) {
+        line += (i ? " " : "") + f(i);
+      }
+      return line;
+    };
+    const auto &vp = header.view_point;
+    char view_point[256];
+    snprintf(view_point, sizeof(view_point), "%.17g %.17g %.17g %.17g %.17g %.17g %.17g", vp.tx, vp.ty, vp.tz, vp.qw,
+             vp.qx, vp.qy, vp.qz);
+    return "# .PCD v0.7 - Point Cloud Data file format\n"
+           "VERSION " + header.version + "\n" +
+           "FIELDS " + join([&](size_t i) { return header.field[i]; }) + "\n" +
+           "SIZE " + join([&](size_t i) { return std::to_string(header.size[i]); }) + "\n" +
+           "TYPE " + join([&](size_t i) { return header.type[i]; }) + "\n" +
+           "COUNT " + join([&](size_t i) { return std::to_string(header.count[i]); }) + "\n" +
+           "WIDTH " + std::to_string(header.width) + "\n" +
+           "HEIGHT " + std::to_string(header.height) + "\n" +
+           "VIEWPOINT " + view_point + "\n" +
+           "POINTS " + std::to_string(header.points) + "\n" +
+           "DATA binary\n";
+  }
+
+  // write every point in the binary layout of header, out is zero filled and holds points * block size bytes
+  void encode_(const Header &header, char *out) const {
+    const auto &in = *header_;
+    if (in.pcd_type == PcdType::BINARY && in.field == header.field && in.size == header.size &&
+        in.count == header.count) {
+      std::memcpy(out, blocks_.data(), blocks_.size());
+      return;
+    }
+
+    const auto stride = block_size_(header);
+    std::vector<char> column;
+    for (size_t j = 0, offset = 0; j < header.field.size(); offset += header.size[j] * header.count[j], ++j) {
+      const auto it = std::find(in.field.begin(), in.field.end(), header.field[j]);
+      if (it == in.field.end()) {
+        continue;
+      }
+      const auto item_size = header.size[j] * header.count[j];
+      column.resize(in.points * item_size);
+      copy_column_(it - in.field.begin(), column.data());
+      for (uint64_t i = 0; i < in.points; ++i) {
+        std::memcpy(out + i * stride + offset, column.data() + i * item_size, item_size);
+      }
+    }
+  }
+
+  template <typename T> using Gather = void (*)(const char *, size_t, T *, size_t);
+
+  template <typename S, typename T> static void gather_(const char *src, size_t stride, T *out, size_t n) {
+    for (size_t i = 0; i < n; ++i, src += stride) {
+      S value;
+      std::memcpy(&value, src, sizeof(S));
+      out[i] = static_cast<T>(value);
+    }
+  }
+
+  template <typename T> static Gather<T> gather_(const std::string &type) {
+    if (type == "int8") {
+      return gather_<int8_t, T>;
+    } else if (type == "uint8") {
+      return gather_<uint8_t, T>;
+    } else if (type == "int16") {
+      return gather_<int16_t, T>;
+    } else if (type == "uint16") {
+      return gather_<uint16_t, T>;
+    } else if (type == "int32") {
+      return gather_<int32_t, T>;
+    } else if (type == "uint32") {
+      return gather_<uint32_t, T>;
+    } else if (type == "int64") {
+      return gather_<int64_t, T>;
+    } else if (type == "uint64") {
+      return gather_<uint64_t, T>;
+    } else if (type == "float32") {
+      return gather_<float, T>;
+    } else if (type == "float64") {
+      return gather_<double, T>;
+    } else {
+      throw std::runtime_error("Unknown type " + type);
+    }
+  }
+
+  // byte offset of a field inside a binary point
+  size_t field_offset_(size_t field_idx) const {
+    return std::inner_product(header_->size.begin(), header_->size.begin() + field_idx, header_->count.begin(), 0);
+  }
+
   static auto block_size_(const Header &header) -> typename decltype(header.size)::value_type {
-    return std::accumulate(header.size.begin(), header.size.end(), 0);
+    return std::inner_product(header.size.begin(), header.size.end(), header.count.begin(), 0);
+  }
+
+  // decode one field of every point into a contiguous native-typed column, out holds points * count * size bytes
+  void copy_column_(size_t field_idx, char *out) const {
+    const auto item_size = header_->size[field_idx] * header_->count[field_idx];
+    if (header_->pcd_type == PcdType::BINARY) {
+      const auto stride = block_size_(*header_);
+      const auto *src = blocks_.data() + field_offset_(field_idx);
+      for (uint64_t i = 0; i < header_->points; ++i, src += stride, out += item_size) {
+        std::memcpy(out, src, item_size);
+      }
+      return;
+    }
+
+    const auto skip = std::accumulate(header_->count.begin(), header_->count.begin() + field_idx, 0u);
+    const auto &type = header_->iso_type[field_idx];
+    auto blocks = blocks_;
+    for (uint64_t i = 0; i < header_->points; ++i) {
+      auto line = next_line(blocks);
+      if (line.empty()) {
+        throw std::runtime_error("Parse error, expect " + std::to_string(header_->points) + " points but got " +
+                                 std::to_string(i));
+      }
+      for (uint32_t token = 0; token < skip + header_->count[field_idx]; ++token) {
+        if (line.empty()) {
+          throw std::runtime_error("Parse error, field not found.\n" + header_->field[field_idx]);
+        }
+        const auto value = next_token(line);
+        if (token >= skip) {
+          store_number(value, type, out);
+          out += header_->size[field_idx];
+        }
+      }
+    }
   }
 
   template <typename T, typename F>
@@ -338,32 +1355,38 @@ class TinyPcd {
   }
 
   void parse_header_(strview buffer) {
+    Header header;
     const auto to_uint32 = [](const strview &str) { return to_number<uint32_t>(str); };
     const auto to_uint64 = [](const strview &str) { return to_number<uint64_t>(str); };
+    const auto to_double = [](const strview &str) { return to_number<double>(str); };
+    std::vector<double> view_point;
     for (auto pos = buffer.find('\n'); pos != strview::npos; pos = buffer.find('\n')) {
       const auto line = buffer.substr(0, pos);
       buffer.remove_prefix(pos + 1);
       if (line.empty()) {
         continue;
       }
-      if (fill_item_("VERSION", line, header_.version, to_string) ||
-          fill_item_("FIELDS", line, header_.field, to_string) || fill_item_("TYPE", line, header_.type, to_string) ||
-          fill_item_("VIEWPOINT", line, header_.view_point, to_string) ||
-          fill_item_("SIZE", line, header_.size, to_uint32) || fill_item_("COUNT", line, header_.count, to_uint32) ||
-          fill_item_("WIDTH", line, header_.width, to_uint32) ||
-          fill_item_("HEIGHT", line, header_.height, to_uint32) ||
-          fill_item_("POINTS", line, header_.points, to_uint64)) {
+      if (fill_item_("VERSION", line, header.version, to_string) ||
+          fill_item_("FIELDS", line, header.field, to_string) || fill_item_("TYPE", line, header.type, to_string) ||
+          fill_item_("VIEWPOINT", line, view_point, to_double) ||
+          fill_item_("SIZE", line, header.size, to_uint32) || fill_item_("COUNT", line, header.count, to_uint32) ||
+          fill_item_("WIDTH", line, header.width, to_uint32) ||
+          fill_item_("HEIGHT", line, header.height, to_uint32) ||
+          fill_item_("POINTS", line, header.points, to_uint64)) {
         // do nothing
       } else if (starts_with(line, "DATA")) {
         blocks_ = buffer;
+        if (header.count.empty()) {
+          header.count.assign(header.field.size(), 1);  // COUNT is optional, default to 1
+        }
         if (line.find("ascii") != strview::npos) {
-          header_.pcd_type = PcdType::ASCII;
+          header.pcd_type = PcdType::ASCII;
         } else if (line.find("binary") != strview::npos) {
-          header_.pcd_type = PcdType::BINARY;
-          if (blocks_.size() != header_.points * block_size_(header_)) {
-            throw std::runtime_error("Parse error, block size " + std::to_string(block_size_(header_)) +
+          header.pcd_type = PcdType::BINARY;
+          if (blocks_.size() != header.points * block_size_(header)) {
+            throw std::runtime_error("Parse error, block size " + std::to_string(block_size_(header)) +
                                      " but got total size " + std::to_string(blocks_.size()) + ", points " +
-                                     std::to_string(header_.points));
+                                     std::to_string(header.points));
           }
         } else {
           throw std::runtime_error("Unknown data type.");
@@ -373,18 +1396,315 @@ class TinyPcd {
       }
     }
 
-    if ((!header_.type.empty()) && (header_.size.size() == header_.type.size())) {
-      for (auto i = 0; i < header_.type.size(); ++i) {
-        header_.iso_type.push_back(to_iso_type(header_.type[i], header_.size[i]));
+    if ((!header.type.empty()) && (header.size.size() == header.type.size())) {
+      for (auto i = 0; i < header.type.size(); ++i) {
+        header.iso_type.push_back(to_iso_type(header.type[i], header.size[i]));
       }
     }
+    if (!view_point.empty()) {
+      if (view_point.size() != 7) {
+        throw std::runtime_error("Parse error, VIEWPOINT expects 7 values but got " +
+                                 std::to_string(view_point.size()));
+      }
+      header.view_point = {view_point[0], view_point[1], view_point[2], view_point[3],
+                           view_point[4], view_point[5], view_point[6]};
+    }
+    header_ = std::make_shared<const Header>(std::move(header));
   }
 
  private:
   Io io_;
-  Header header_;
+  std::shared_ptr<const Header> header_;
   strview blocks_;
-  mutable std::vector<Iterator> points_;  // only for ascii
+  mutable std::once_flag lines_once_;
+  mutable std::vector<strview> lines_index_;  // only for ascii
+  mutable std::once_flag valid_once_;
+  mutable Validity validity_state_;
+};
+
+// columnar sidecar cache of a pcd file, every field is stored as a 64-byte aligned native-typed column.
+// the cache is mapped read-only and rebuilt automatically when the source pcd changes.
+class TinyPcdCache {
+ private:
+  using strview = std::string_view;
+  static constexpr char kMagic[8] = {'T', 'P', 'C', 'D', 'C', 'O', 'L', '\0'};
+  static constexpr uint32_t kVersion = 2;
+  static constexpr uint64_t kAlign = 64;
+  static constexpr size_t kNameSize = 32;
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t fields;
+    uint64_t points;
+    uint32_t width;
+    uint32_t height;
+    uint64_t source_size;
+    int64_t source_mtime;  // nanoseconds
+    uint64_t source_checksum;
+    double view_point[7];
+    uint8_t reserved[16];
+  };
+
+  struct FileField {
+    char name[kNameSize];
+    char type;
+    uint8_t reserved[3];
+    uint32_t size;
+    uint32_t count;
+    uint32_t padding;
+    uint64_t offset;
+    uint64_t bytes;
+  };
+
+  static_assert(sizeof(FileHeader) == 2 * kAlign && sizeof(FileField) == kAlign, "cache layout changed");
+
+ public:
+  template <typename T> class Column {
+   public:
+    Column(const T *data, size_t size) : data_(data), size_(size) {}
+    const T *data() const { return data_; }
+    size_t size() const { return size_; }
+    const T &operator[](size_t index) const { return data_[index]; }
+    const T *begin() const { return data_; }
+    const T *end() const { return data_ + size_; }
+
+   private:
+    const T *data_;
+    size_t size_;
+  };
+
+  // the cache defaults to "<filename>.tpc" next to the source
+  TinyPcdCache(const std::string &filename, const std::string &cache_filename = "")
+      : io_(prepare_(filename, cache_filename.empty() ? default_path(filename) : cache_filename)) {
+    parse_();
+  }
+
+  static std::string default_path(const std::string &filename) { return filename + ".tpc"; }
+
+  // convert a pcd into its columnar cache, overwriting the existing one
+  static void build(const std::string &filename, const std::string &cache_filename) {
+    const TinyPcd pcd(filename);
+    build_(pcd, stat_(filename), checksum_(pcd.io_.view()), cache_filename);
+  }
+
+  TinyPcd::Header header() const { return header_; }
+  auto size() const { return header_.points; }
+  auto fields() const { return header_.field; }
+  auto width() const { return header_.width; }
+  auto height() const { return header_.height; }
+
+  // zero-copy typed access, T must match the stored type and size of the field
+  template <typename T> Column<T> column(const std::string &field) const {
+    const auto field_idx = field_idx_(field);
+    const auto &type = header_.type[field_idx];
+    const bool match = sizeof(T) == header_.size[field_idx] &&
+                       ((std::is_floating_point_v<T> && type == "F") ||
+                        (std::is_integral_v<T> && std::is_signed_v<T> && type == "I") ||
+                        (std::is_integral_v<T> && std::is_unsigned_v<T> && type == "U"));
+    if (!match) {
+      throw std::runtime_error("Type mismatch for field " + field + ", stored as " + header_.iso_type[field_idx]);
+    }
+    const auto *data = reinterpret_cast<const T *>(columns_[field_idx].data());
+    return Column<T>(data, header_.points * header_.count[field_idx]);
+  }
+
+  // raw bytes of a column, points * count * size long
+  strview data(const std::string &field) const { return columns_.at(field_idx_(field)); }
+
+ private:
+  struct SourceStat {
+    uint64_t size{0};
+    int64_t mtime{0};
+  };
+
+  static SourceStat stat_(const std::string &filename) {
+    SourceStat result;
+#ifdef __linux__
+    struct stat sb;
+    if (stat(filename.c_str(), &sb) == -1) {
+      throw std::runtime_error("Failed to stat the file " + filename);
+    }
+    result.size = sb.st_size;
+    result.mtime = static_cast<int64_t>(sb.st_mtim.tv_sec) * 1000000000 + sb.st_mtim.tv_nsec;
+#else
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+      throw std::runtime_error("Failed to open the file " + filename);
+    }
+    result.size = file.tellg();
+#endif
+    return result;
+  }
+
+  // FNV-1a 64
+  static uint64_t checksum_(strview buffer) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto c : buffer) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  static uint64_t align_(uint64_t offset) { return (offset + kAlign - 1) / kAlign * kAlign; }
+
+  static bool read_header_(const std::string &cache_filename, FileHeader &header) {
+    std::ifstream file(cache_filename, std::ios::binary);
+    if (!file.is_open() || !file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+      return false;
+    }
+    return std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+  }
+
+  // record the new mtime of an unchanged source so later opens skip the checksum, best effort only
+  static void touch_(const std::string &cache_filename, int64_t mtime) {
+    std::fstream file(cache_filename, std::ios::binary | std::ios::in | std::ios::out);
+    if (file.is_open()) {
+      file.seekp(offsetof(FileHeader, source_mtime));
+      file.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+    }
+  }
+
+  static std::string prepare_(const std::string &filename, const std::string &cache_filename) {
+    const auto source = stat_(filename);
+    FileHeader cached;
+    if (read_header_(cache_filename, cached) && cached.source_size == source.size) {
+      if (source.mtime != 0 && cached.source_mtime == source.mtime) {
+        return cache_filename;
+      }
+      // touched but maybe not modified, only the content decides
+      const TinyPcd pcd(filename);
+      const auto checksum = checksum_(pcd.io_.view());
+      if (checksum == cached.source_checksum) {
+        touch_(cache_filename, source.mtime);
+        return cache_filename;
+      }
+      build_(pcd, source, checksum, cache_filename);
+      return cache_filename;
+    }
+
+    const TinyPcd pcd(filename);
+    build_(pcd, source, checksum_(pcd.io_.view()), cache_filename);
+    return cache_filename;
+  }
+
+  static void build_(const TinyPcd &pcd, const SourceStat &source, uint64_t checksum,
+                     const std::string &cache_filename) {
+    const auto &header = *pcd.header_;
+    if (header.iso_type.size() != header.field.size()) {
+      throw std::runtime_error("Incomplete header, FIELDS, SIZE and TYPE are required.");
+    }
+
+    FileHeader file_header{};
+    std::memcpy(file_header.magic, kMagic, sizeof(kMagic));
+    file_header.version = kVersion;
+    file_header.fields = header.field.size();
+    file_header.points = header.points;
+    file_header.width = header.width;
+    file_header.height = header.height;
+    file_header.source_size = source.size;
+    file_header.source_mtime = source.mtime;
+    file_header.source_checksum = checksum;
+    const auto &vp = header.view_point;
+    const double view_point[7] = {vp.tx, vp.ty, vp.tz, vp.qw, vp.qx, vp.qy, vp.qz};
+    std::memcpy(file_header.view_point, view_point, sizeof(view_point));
+
+    std::vector<FileField> file_fields(header.field.size());
+    auto offset = align_(sizeof(FileHeader) + sizeof(FileField) * file_fields.size());
+    for (size_t i = 0; i < file_fields.size(); ++i) {
+      auto &field = file_fields[i];
+      if (header.field[i].size() >= kNameSize) {
+        throw std::runtime_error("Field name too long " + header.field[i]);
+      }
+      std::memcpy(field.name, header.field[i].data(), header.field[i].size());
+      field.type = header.type[i].front();
+      field.size = header.size[i];
+      field.count = header.count[i];
+      field.offset = offset;
+      field.bytes = header.points * header.size[i] * header.count[i];
+      offset = align_(offset + field.bytes);
+    }
+
+    // write aside and rename, readers never see a half written cache
+    const auto temp_filename = create_temp(cache_filename);
+    try {
+      std::ofstream file(temp_filename, std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) {
+        throw std::runtime_error("Failed to create the cache " + temp_filename);
+      }
+      file.write(reinterpret_cast<const char *>(&file_header), sizeof(file_header));
+      file.write(reinterpret_cast<const char *>(file_fields.data()), sizeof(FileField) * file_fields.size());
+
+      std::vector<char> column;
+      const char zeros[kAlign] = {};
+      for (size_t i = 0; i < file_fields.size(); ++i) {
+        file.write(zeros, file_fields[i].offset - file.tellp());
+        column.resize(file_fields[i].bytes);
+        pcd.copy_column_(i, column.data());
+        file.write(column.data(), column.size());
+      }
+      file.write(zeros, offset - file.tellp());
+      if (!file) {
+        throw std::runtime_error("Failed to write the cache " + temp_filename);
+      }
+    } catch (...) {
+      // the stream is closed by now, drop the partial file so retries don't pile them up
+      std::remove(temp_filename.c_str());
+      throw;
+    }
+    if (std::rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+      std::remove(temp_filename.c_str());
+      throw std::runtime_error("Failed to replace the cache " + cache_filename);
+    }
+  }
+
+  void parse_() {
+    const auto view = io_.view();
+    FileHeader file_header;
+    if (view.size() < sizeof(file_header)) {
+      throw std::runtime_error("Parse error, cache too small.");
+    }
+    std::memcpy(&file_header, view.data(), sizeof(file_header));
+    if (std::memcmp(file_header.magic, kMagic, sizeof(kMagic)) != 0 || file_header.version != kVersion) {
+      throw std::runtime_error("Parse error, not a cache file.");
+    }
+    if (view.size() < sizeof(FileHeader) + sizeof(FileField) * file_header.fields) {
+      throw std::runtime_error("Parse error, cache truncated.");
+    }
+
+    header_.points = file_header.points;
+    header_.width = file_header.width;
+    header_.height = file_header.height;
+    header_.pcd_type = TinyPcd::PcdType::BINARY;
+    const auto *vp = file_header.view_point;
+    header_.view_point = {vp[0], vp[1], vp[2], vp[3], vp[4], vp[5], vp[6]};
+    for (uint32_t i = 0; i < file_header.fields; ++i) {
+      FileField field;
+      std::memcpy(&field, view.data() + sizeof(FileHeader) + sizeof(FileField) * i, sizeof(field));
+      if (field.offset + field.bytes > view.size()) {
+        throw std::runtime_error("Parse error, cache truncated.");
+      }
+      header_.field.emplace_back(field.name, std::find(field.name, field.name + kNameSize, '\0'));
+      header_.type.emplace_back(1, field.type);
+      header_.size.push_back(field.size);
+      header_.count.push_back(field.count);
+      header_.iso_type.push_back(to_iso_type(header_.type.back(), field.size));
+      columns_.push_back(view.substr(field.offset, field.bytes));
+    }
+  }
+
+  size_t field_idx_(const std::string &field) const {
+    const auto field_it = std::find(header_.field.begin(), header_.field.end(), field);
+    if (field_it == header_.field.end()) {
+      throw std::runtime_error("Unknow filed " + field);
+    }
+    return field_it - header_.field.begin();
+  }
+
+ private:
+  TinyPcd::Io io_;
+  TinyPcd::Header header_;
+  std::vector<strview> columns_;
 };
 
 }  // namespace tiny_pcd